@@ -20,13 +20,19 @@
         -p      Protocol    (more in future, these for now)
                     u(art)
                     s(pi)
+                    c(an)
 
         -f      Format
                     Uart:
                         {5-8}{N/E/O}{1/2}
 
                     Spi:
-                        0-3 (Mode)
+                        {0-3}{S/D/Q}
+                        Mode, single/dual/quad data lanes
+
+                    Can:
+                        {S/E}{1-8}
+                        Standard/Extended ID, data bytes per frame
 
         -d      Data
                     hex string of data
@@ -47,6 +53,17 @@
                     Number of bits to stall between data frames
                     before sending next frame
 
+        -I      CAN Identifier
+                    hex, 11 bit standard or 29 bit extended
+
+        -o      Output prefix
+                    prepended to every generated file name
+                    eg. "out/" or "run0_"
+
+        -S      Serve requests on a UNIX domain socket
+                    socket path, optional worker count
+                    must be the first option
+
         Protocol option MUST come first, inline data must not be last argument
             if this is desired please terminate the data input with a " -"
             to indicate a field stop
@@ -65,6 +82,21 @@
 
 //#define DEBUG_OUTPUT
 
+// Persistent generator daemon (-S), comment out on non POSIX hosts
+#define SERVER_SUPPORT
+
+#ifdef SERVER_SUPPORT
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif // SERVER_SUPPORT
+
 #define MINARGS     4
 #define ISARG(a)    ((a == '-') ? 1 : 0)
 #define MAX(a,b)    ((a > b) ? a : b)
@@ -79,53 +111,127 @@
 #define BAUD        'b'
 #define GEN_TB      'T'
 #define PAUSEBITS   'P'
+#define OUT_PREFIX  'o'
+#define CAN_IDENT   'I'
+#define SERVE       'S'
 
 struct EXTFILE_IO{
     uint8_t *data_buffer;
-    uint16_t data_length;
+    uint32_t data_length;
 } EXTFILE_IO;
 
+// Testbench step timing in picoseconds, exact as
+//  step_ps + frac_num / frac_den
+struct BAUD_TIMING{
+    uint64_t    step_ps;
+    uint64_t    frac_num;
+    uint64_t    frac_den;
+    uint64_t    startup_ps;     // One whole bit / SCLK period
+};
+
+// Everything a single generation run needs. Filled in by parse_args()
+//  from either the command line or a daemon request line.
+struct GEN_PARAMS{
+    uint8_t     state_select[MINARGS];  // State parameters that drive generation
+    uint8_t     *data_set;              // Pointer to dynamic sample array to serialize
+    uint32_t    data_count;             // Number of data fields in file or inline
+    uint32_t    baudrate;               // Bits per second, plays into testbench delays
+    uint8_t     opt;                    // Testbench generation and more here
+    uint32_t    pause;                  // Pause between data frames in units of bits
+    uint8_t     datawidth;              // Data width of external file values
+    uint32_t    can_id;                 // CAN frame identifier
+    char        out_prefix[MAX_PATH_LEN];   // Prepended to every output file name
+    char        mem_path[MAX_PATH_LEN];     // Set by serializer()
+    char        tb_path[MAX_PATH_LEN];      // Set by serializer(), empty if no TB
+};
+
 
 uint8_t is_valid_protocol(char *input_str);
 uint8_t fmt_create(uint8_t protocol_type, char *input_str);
 uint8_t fmt_uart(char *input_str);
+uint8_t fmt_spi(char *input_str);
+uint8_t fmt_can(char *input_str);
 
-uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width);
-
-void serializer(uint8_t *rules, uint32_t baud, uint8_t *data_src, uint16_t data_len, uint8_t opt, uint32_t pause_bits);
-uint16_t uart_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint16_t data_len, uint32_t pause_bits);
-void generate_tb(FILE *fp, uint8_t protocol, uint32_t delay_ns, uint16_t values_written);
+void init_gen_params(struct GEN_PARAMS *gp);
+void parse_args(struct GEN_PARAMS *gp, int argc, char **argv);
+const char *gen_params_error(struct GEN_PARAMS *gp);
 
-// Struct transition in the future, this is getting too big for how it is now
-/*
-struct {
-    uint16_t values_written;
-    uint16_t data_bytes_written;
-    uint16_t padding_bits_written;
-} GENVALS;
-*/
+uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width);
+uint8_t load_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width);
+
+uint32_t serializer(struct GEN_PARAMS *gp);
+uint32_t uart_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint32_t data_len, uint32_t pause_bits);
+uint32_t spi_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint32_t data_len, uint8_t word_bytes, uint32_t pause_bits);
+uint32_t can_mem_gen(FILE *fp, uint8_t fmt_rules, uint32_t can_id, uint8_t *data_src, uint32_t data_len, uint32_t pause_bits);
+void baud_timing(struct BAUD_TIMING *bt, uint32_t baud, uint8_t steps_per_bit);
+void generate_tb(FILE *fp, uint8_t protocol, struct BAUD_TIMING *bt, uint32_t values_written, const char *mem_path);
+void generate_spi_tb(FILE *fp, uint8_t fmt_rules, struct BAUD_TIMING *bt, uint32_t values_written, const char *mem_path);
+
+#ifdef SERVER_SUPPORT
+static uint8_t extfile_cache_enabled = 0;  // Set once the daemon is up
+
+uint8_t cached_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width);
+void run_server(const char *sock_path, uint32_t workers);
+#endif // SERVER_SUPPORT
+
+int main(int argc, char **argv){
+#ifdef SERVER_SUPPORT
+    // Daemon mode takes only a socket path and optional worker count,
+    //  run_server() only comes back if it could not start
+    if(argc > 2 && ISARG(argv[1][0]) && argv[1][1] == SERVE){
+        run_server(argv[2], (argc > 3) ? (uint32_t)strtol(argv[3], NULL, 10) : SERVER_WORKERS);
+        return 1;
+    }
+#endif // SERVER_SUPPORT
 
-void main(int argc, char **argv){
     if(argc < MINARGS){
         printf("Invalid number of arguments.\n");
-        return;
+        return 1;
     }
 #ifdef DEBUG_OUTPUT
     else printf("%3u Arguments Provided\n", argc);
 
 #endif // DEBUG_OUTPUT
 
-    uint8_t     state_select[MINARGS] = {0x00}; // State parameters that drive generation
-    uint8_t     *data_set;                  // Pointer to dynamic sample array to serialize
-    uint16_t    data_count = 0;             // Number of data fields in file or inline
+    struct GEN_PARAMS gp;
+    init_gen_params(&gp);
 
-    uint8_t     endianness = ___LITTLE_ENDIAN___; // Default data format, will be variable someday
-    uint32_t    baudrate = 1;   // Bits per second, plays into testbench delays
+    parse_args(&gp, argc, argv);
+
+    // Verify nothing weird on user entry
+    const char *entry_error = gen_params_error(&gp);
+    if(entry_error){
+        printf("Error on %s Entry. Please try again.\n", entry_error);
+        free(gp.data_set);
+        return 1;
+    }
+
+    uint32_t serialized_vals = serializer(&gp);
+
+    free(gp.data_set);
+
+    if(!serialized_vals){
+        return 1;
+    }
+
+    printf("All done :^)\n");
+    return 0;
 
-    uint8_t     OPT = 0;        // Testbench generation and more here
-    uint32_t    PAUSE = 0;      // Pause between data frames in units of bits
+}   // END MAIN
+
+/////////////////////////////////////////////////////////////////////////////
+// Default generation parameters, before any arguments are applied
+void init_gen_params(struct GEN_PARAMS *gp){
+    memset(gp, 0, sizeof(struct GEN_PARAMS));
+    gp->data_set = NULL;
+    gp->baudrate = 1;
+    gp->datawidth = 8;      // Default 8 bit width vals
+}
 
-    uint8_t     DATAWIDTH = 8;  // Default 8 bit width vals
+/////////////////////////////////////////////////////////////////////////////
+// Apply command line style arguments to a set of generation parameters
+void parse_args(struct GEN_PARAMS *gp, int argc, char **argv){
+    uint8_t     endianness = ___LITTLE_ENDIAN___; // Default data format, will be variable someday
 
     for(uint32_t n = 1; n < MAX(MINARGS, argc); n++){
         if(ISARG(argv[n][0])){
@@ -134,26 +240,34 @@ void main(int argc, char **argv){
  #endif // DEBUG_OUTPUT
             switch(argv[n][1]){
                 case PROTOCOL:
-                    state_select[PROTOCOL_PTR] = is_valid_protocol(argv[++n]);
+                    if(n + 1 < argc){
+                        gp->state_select[PROTOCOL_PTR] = is_valid_protocol(argv[++n]);
+                    } else {
+                        gp->state_select[PROTOCOL_PTR] = RETURN_ERROR;
+                    }
 #ifdef DEBUG_OUTPUT
-                    printf("Selected Protocol: %c\n", state_select[PROTOCOL_PTR]);
+                    printf("Selected Protocol: %c\n", gp->state_select[PROTOCOL_PTR]);
 #endif
                 break;
 
                 case FORMAT:
-                    state_select[FORMAT_PTR] = fmt_create(state_select[PROTOCOL_PTR], argv[++n]);
+                    if(n + 1 < argc){
+                        gp->state_select[FORMAT_PTR] = fmt_create(gp->state_select[PROTOCOL_PTR], argv[++n]);
+                    } else {
+                        gp->state_select[FORMAT_PTR] = RETURN_ERROR;
+                    }
                 break;
 
                 case DATA_WIDTH:
-                    if(n < argc) DATAWIDTH = (uint8_t)strtol(argv[++n], NULL, 10);
+                    if(n + 1 < argc) gp->datawidth = (uint8_t)strtol(argv[++n], NULL, 10);
 
-                    if(DATAWIDTH == 8
-                       || DATAWIDTH == 16
-                       || DATAWIDTH == 24
-                       || DATAWIDTH == 32){
+                    if(gp->datawidth == 8
+                       || gp->datawidth == 16
+                       || gp->datawidth == 24
+                       || gp->datawidth == 32){
                        } else {
                             printf("Invalid data width provided. Defaulting to 8 bits.\n");
-                            DATAWIDTH = 8;
+                            gp->datawidth = 8;
                        }
                 break;
 
@@ -161,16 +275,22 @@ void main(int argc, char **argv){
 #ifdef DEBUG_OUTPUT
                     printf("Inline data source\n");
 #endif // DEBUG_OUTPUT
-                    state_select[DATA_SRC_PTR] = DATA_INLINE;
-                    uint8_t tmp_ptr = n + 1;
+                    if(gp->data_set || gp->data_count || gp->state_select[DATA_SRC_PTR] == RETURN_ERROR){
+                        printf("Only one data source may be given!\n");
+                        gp->state_select[DATA_SRC_PTR] = RETURN_ERROR;
+                        break;
+                    }
+
+                    gp->state_select[DATA_SRC_PTR] = DATA_INLINE;
+                    uint32_t tmp_ptr = n + 1;
                     // Find size we need for malloc
-                    while(!ISARG(argv[tmp_ptr][0])){
-                        data_count += 1;
+                    while(tmp_ptr < argc && !ISARG(argv[tmp_ptr][0])){
+                        gp->data_count += 1;
 
                         uint32_t val_bounds_check;
 
-                        if(argv[n + 1 + tmp_ptr][0] == 'x' || argv[n + 1 + tmp_ptr][0] == 'X'
-                                || argv[n + 1 + tmp_ptr][1] == 'x' || argv[n + 1 + tmp_ptr][1] == 'X'){
+                        if(argv[tmp_ptr][0] == 'x' || argv[tmp_ptr][0] == 'X'
+                                || argv[tmp_ptr][1] == 'x' || argv[tmp_ptr][1] == 'X'){
 
                             val_bounds_check = (uint32_t)strtol(             \
                                                     &argv[tmp_ptr][0],      \
@@ -185,21 +305,21 @@ void main(int argc, char **argv){
 
                         // If user value is larger than X bits
                         if(val_bounds_check > 0x000000FF){
-                            data_count += 1;
+                            gp->data_count += 1;
                         }
 
                         if(val_bounds_check > 0x0000FFFF){
-                            data_count += 1;
+                            gp->data_count += 1;
                         }
 
                         if(val_bounds_check > 0x00FFFFFF){
-                            data_count += 1;
+                            gp->data_count += 1;
                         }
 
                         tmp_ptr += 1;
 
-                        if(data_count > MAX_DIN_CT){
-                            state_select[DATA_SRC_PTR] = RETURN_ERROR;
+                        if(gp->data_count > MAX_DIN_CT){
+                            gp->state_select[DATA_SRC_PTR] = RETURN_ERROR;
                             break;
                         }
                     }
@@ -208,20 +328,23 @@ void main(int argc, char **argv){
                     //  this dynamically sizes transmissions to the value
                     //  the user has entered. NOT fixed width unless all data
                     //  is within the same bit width
-                    if(state_select[DATA_SRC_PTR] != RETURN_ERROR){
-                        data_set = (uint8_t *)malloc(data_count * sizeof(uint8_t));
+                    if(gp->state_select[DATA_SRC_PTR] != RETURN_ERROR){
+                        uint8_t *data_set = (uint8_t *)malloc(gp->data_count * sizeof(uint8_t));
+                        gp->data_set = data_set;
 
-                        for(uint16_t m = 0; m < data_count; m++){
+                        // m walks the output bytes, arg_ptr walks the user values
+                        uint32_t arg_ptr = n + 1;
+                        for(uint16_t m = 0; m < gp->data_count; m++, arg_ptr++){
                             uint32_t user_val;
-                            if(argv[n + 1 + m][0] == 'x' || argv[n + 1 + m][0] == 'X'
-                                || argv[n + 1 + m][1] == 'x' || argv[n + 1 + m][1] == 'X'){
+                            if(argv[arg_ptr][0] == 'x' || argv[arg_ptr][0] == 'X'
+                                || argv[arg_ptr][1] == 'x' || argv[arg_ptr][1] == 'X'){
 
-                                user_val = (uint32_t)strtol(argv[n + 1 + m], NULL, 16);
+                                user_val = (uint32_t)strtol(argv[arg_ptr], NULL, 16);
                             } else {
-                                user_val = (uint32_t)strtol(argv[n + 1 + m], NULL, 10);
+                                user_val = (uint32_t)strtol(argv[arg_ptr], NULL, 10);
                             }
 
-                            if(endianness == LITTLE_ENDIAN){
+                            if(endianness == ___LITTLE_ENDIAN___){
                                 data_set[m] = (uint8_t)(user_val & 0xFF);
 #ifdef DEBUG_OUTPUT
                                 printf("Data[%2u] = 0x%02X\n", m, data_set[m]);
@@ -251,48 +374,33 @@ void main(int argc, char **argv){
 
                         }
                     }
-
-                    /*
-                    // If valid data found
-                    if(state_select[DATA_SRC_PTR] != RETURN_ERROR){
-                        data_set = (char *)malloc(data_size * sizeof(char));
-                        tmp_ptr = n + 1;
-                        uint16_t tmp_str_pt = 0;
-                        uint16_t tmp_data_pt = 0;
-
-                        // Copy input strings into buffer
-                        for(uint16_t m = 0; m < data_count;){
-                            if(argv[m + tmp_ptr][tmp_str_pt]){
-                                data_set[tmp_data_pt++] = argv[m + tmp_ptr][tmp_str_pt++];
-                            } else {
-                                data_set[tmp_data_pt++] = NEWLINE;
-                                tmp_str_pt = 0;
-                                m += 1;
-                            }
-
-                        }
-
-                    }
-                    */
                 }
                 break;
 
                 case DATA_FILE:{
-                    state_select[DATA_SRC_PTR] = DATA_EXTERNAL;
+                    if(gp->data_set || gp->data_count || gp->state_select[DATA_SRC_PTR] == RETURN_ERROR){
+                        printf("Only one data source may be given!\n");
+                        gp->state_select[DATA_SRC_PTR] = RETURN_ERROR;
+                        break;
+                    }
+
+                    gp->state_select[DATA_SRC_PTR] = DATA_EXTERNAL;
                     struct EXTFILE_IO *file_data;
                     file_data = (struct EXTFILE_IO *)malloc(sizeof(EXTFILE_IO));
 
 
                     //uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width){
-                    if(n < argc){
-                        if(handle_external_data(file_data, argv[++n], 16, DATAWIDTH)){
+                    if(n + 1 < argc){
+                        if(load_external_data(file_data, argv[++n], 16, gp->datawidth)){
                             printf("File handling error!!\n");
+                            gp->state_select[DATA_SRC_PTR] = RETURN_ERROR;
                         } else {
-                            data_set = file_data->data_buffer;
-                            data_count = file_data->data_length;
+                            gp->data_set = file_data->data_buffer;
+                            gp->data_count = file_data->data_length;
                         }
                     } else {
                         printf("No file path provided!\n");
+                        gp->state_select[DATA_SRC_PTR] = RETURN_ERROR;
                     }
 
 
@@ -301,9 +409,13 @@ void main(int argc, char **argv){
                 break;
 
                 case BAUD:
-                    baudrate = (uint32_t)strtol(argv[++n], NULL, 10);
+                    if(n + 1 < argc){
+                        gp->baudrate = (uint32_t)strtol(argv[++n], NULL, 10);
+                    } else {
+                        gp->baudrate = 0;
+                    }
 #ifdef DEBUG_OUTPUT
-                    printf("Baudrate Selected: %u\n", baudrate);
+                    printf("Baudrate Selected: %u\n", gp->baudrate);
 #endif // DEBUG_OUTPUT
                 break;
 
@@ -311,50 +423,73 @@ void main(int argc, char **argv){
 #ifdef DEBUG_OUTPUT
                     printf("Testbench Generation Enabled.\n");
 #endif // DEBUG_OUTPUT
-                    OPT |= GENERATE_TB;
+                    gp->opt |= GENERATE_TB;
                 break;
 
                 case PAUSEBITS:
-                    if(n < argc) PAUSE = (uint32_t)strtol(argv[++n], NULL, 10);
+                    if(n + 1 < argc) gp->pause = (uint32_t)strtol(argv[++n], NULL, 10);
+                break;
+
+                case OUT_PREFIX:
+                    if(n + 1 < argc){
+                        if(strlen(argv[++n]) > MAX_OUT_PREFIX_LEN){
+                            printf("Output prefix longer than %u characters!\n", (uint32_t)MAX_OUT_PREFIX_LEN);
+                            gp->state_select[OUTPUT_PTR] = RETURN_ERROR;
+                        } else {
+                            strcpy(gp->out_prefix, argv[n]);
+                        }
+                    }
+                break;
+
+                case CAN_IDENT:
+                    if(n + 1 < argc){
+                        char *id_end;
+                        unsigned long id = strtoul(argv[++n], &id_end, 16);
+
+                        // Checked against the frame format in gen_params_error()
+                        gp->can_id = (*id_end || id > CAN_EXT_ID_MASK) ? CAN_ID_INVALID : (uint32_t)id;
+                    }
                 break;
             }
         }
     }
+}
 
-    // Verify nothing weird on user entry
+/////////////////////////////////////////////////////////////////////////////
+// Name of the first bad parameter group, NULL if everything checks out
+const char *gen_params_error(struct GEN_PARAMS *gp){
     for(uint16_t n = 0; n < MINARGS; n++){
-        if(state_select[n] == RETURN_ERROR){
-            printf("Error on ");
+        if(gp->state_select[n] == RETURN_ERROR){
             switch(n){
                 case PROTOCOL_PTR:
-                    printf("Protocol");
-                break;
+                    return "Protocol";
 
                 case FORMAT_PTR:
-                    printf("Format");
-                break;
+                    return "Format";
 
                 case DATA_SRC_PTR:
-                    printf("Data");
-                break;
-            }
+                    return "Data";
 
-            printf(" Entry. Please try again.\n");
-            return;
+                case OUTPUT_PTR:
+                    return "Output Prefix";
+
+                default:
+                    return "Unknown";
+            }
         }
     }
 
-    //void serializer(uint8_t *rules, uint32_t baud, uint8_t *data_src, uint16_t data_len, uint8_t opt){
-    serializer(state_select, baudrate, data_set, data_count, OPT, PAUSE);
-
-
-    if(state_select[DATA_SRC_PTR] != RETURN_ERROR){
-        free(data_set);
+    if(!gp->baudrate){
+        return "Baudrate";
     }
 
-    printf("All done :^)\n");
+    if(gp->state_select[PROTOCOL_PTR] == PROTOCOL_CAN
+        && (gp->can_id & ~((gp->state_select[FORMAT_PTR] & CAN_EXT_ID) ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK))){
+        return "CAN Identifier";
+    }
 
-}   // END MAIN
+    return NULL;
+}
 
 /////////////////////////////////////////////////////////////////////////////
 // Check if protocol requested is supported
@@ -370,6 +505,9 @@ uint8_t is_valid_protocol(char *input_str){
         case PROTOCOL_SPI:
             retval = PROTOCOL_SPI;
         break;
+        case PROTOCOL_CAN:
+            retval = PROTOCOL_CAN;
+        break;
         default:
             retval = RETURN_ERROR;
         break;
@@ -391,8 +529,11 @@ uint8_t fmt_create(uint8_t protocol_type, char *input_str){
         break;
 
         case PROTOCOL_SPI:
-            printf("Unsupported right now! :(\n");
-            retval = RETURN_ERROR;
+            retval = fmt_spi(input_str);
+        break;
+
+        case PROTOCOL_CAN:
+            retval = fmt_can(input_str);
         break;
 
         default:
@@ -427,7 +568,7 @@ uint8_t fmt_uart(char *input_str){
     if(input_str[0] > ('5' - 0x01) && input_str[0] < ('9' + 0x01)){
         retval = (input_str[0] - '0') & 0x0F;
     } else {
-        retval = RETURN_ERROR;
+        return RETURN_ERROR;
     }
 
     switch(input_str[1]){
@@ -442,7 +583,8 @@ uint8_t fmt_uart(char *input_str){
         break;
     }
 
-    if(input_str[2] == '2'){
+    // Stop count is optional, don't read past a short string
+    if(input_str[1] && input_str[2] == '2'){
         retval |= UART_2_STOP;
     } else {
         retval |= UART_1_STOP;
@@ -450,6 +592,88 @@ uint8_t fmt_uart(char *input_str){
 
     return retval;
 }
+
+// SPI Format Byte Structure:
+//  7   6   5   4   3   2   1   0
+//  -   -   -   -   L   L   O   H
+//
+//      L: Data lanes
+//          0: Single (S, dfl)
+//          1: Dual (D)
+//          2: Quad (Q)
+//      O: CPOL, SCLK idle level
+//      H: CPHA
+//          0: Sample on leading edge
+//          1: Sample on trailing edge
+uint8_t fmt_spi(char *input_str){
+    uint8_t retval;
+
+#ifdef DEBUG_OUTPUT
+    printf("FUNCTION MESSAGE: SPI Format\t%s\n", input_str);
+#endif // DEBUG_OUTPUT
+
+    if(input_str[0] >= '0' && input_str[0] <= '3'){
+        retval = (input_str[0] - '0') & SPI_MODE_MASK;
+    } else {
+        return RETURN_ERROR;
+    }
+
+    switch(input_str[1]){
+        case 0:
+        case 'S':
+            retval |= SPI_SINGLE;
+        break;
+        case 'D':
+            retval |= SPI_DUAL;
+        break;
+        case 'Q':
+            retval |= SPI_QUAD;
+        break;
+        default:
+            retval = RETURN_ERROR;
+        break;
+    }
+
+    return retval;
+}
+
+// CAN Format Byte Structure:
+//  7   6   5   4   3   2   1   0
+//  X   -   -   -   L   L   L   L
+//
+//      X: Identifier
+//          0: Standard 11 bit (S)
+//          1: Extended 29 bit (E)
+//      L: Data bytes per frame (1-8), a shorter
+//          final frame carries whatever is left
+uint8_t fmt_can(char *input_str){
+    uint8_t retval;
+
+#ifdef DEBUG_OUTPUT
+    printf("FUNCTION MESSAGE: CAN Format\t%s\n", input_str);
+#endif // DEBUG_OUTPUT
+
+    switch(input_str[0]){
+        case 'S':
+            retval = CAN_STD_ID;
+        break;
+        case 'E':
+            retval = CAN_EXT_ID;
+        break;
+        default:
+            return RETURN_ERROR;
+    }
+
+    if(!input_str[1]){
+        retval |= CAN_MAX_DLC;
+    } else if(input_str[1] > '0' && input_str[1] < ('0' + CAN_MAX_DLC + 1)){
+        retval |= (input_str[1] - '0') & CAN_DLC_MASK;
+    } else {
+        retval = RETURN_ERROR;
+    }
+
+    return retval;
+}
 /////////////////////////////////////////////////////////////////////////////
 // Handle external file input, parse, and allocation
 //  account for different bases of data
@@ -466,8 +690,8 @@ uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, con
         char linebuffer[MAX_DIN_CHAR_LEN];
         uint8_t read_len;
         int32_t tmp_rd_val;
-        uint16_t file_line_ct;
-        uint16_t dynarr_wp = 0;
+        uint32_t file_line_ct = 0;
+        uint32_t dynarr_wp = 0;
 
         // Get line len of file
         char testchar = getc(extfp);
@@ -489,7 +713,7 @@ uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, con
 #endif
         if(file_params->data_buffer){
             if(basesel == 10){
-                for(uint16_t n = 0; n < file_line_ct; n++){
+                for(uint32_t n = 0; n < file_line_ct; n++){
                     read_len = fscanf(extfp, "%d", &tmp_rd_val);
 
                     uint8_t *tv = (uint8_t *)(&tmp_rd_val);
@@ -509,7 +733,7 @@ uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, con
 
                 }
             } else {
-                for(uint16_t n = 0; n < file_line_ct; n++){
+                for(uint32_t n = 0; n < file_line_ct; n++){
                     read_len = fscanf(extfp, "%x", &tmp_rd_val);
 
                     uint8_t *tv = (uint8_t *)(&tmp_rd_val);
@@ -533,48 +757,111 @@ uint8_t handle_external_data(struct EXTFILE_IO *file_params, char *filepath, con
             retval = RETURN_ERROR;
         }
 
-
+        fclose(extfp);
     }
 
     return retval;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// External data source entry point, goes through the warm
+//  file cache when running as a daemon
+uint8_t load_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width){
+#ifdef SERVER_SUPPORT
+    if(extfile_cache_enabled){
+        return cached_external_data(file_params, filepath, basesel, d_width);
+    }
+#endif // SERVER_SUPPORT
+    return handle_external_data(file_params, filepath, basesel, d_width);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Actually create output serial data stream and
 //  associated testbench driver code.
+//  Returns the number of serialized values, 0 on failure.
 
-void serializer(uint8_t *rules, uint32_t baud, uint8_t *data_src, uint16_t data_len, uint8_t opt, uint32_t pause_bits){
+uint32_t serializer(struct GEN_PARAMS *gp){
     FILE *memfile;
     FILE *tb_file;
 
+    uint8_t *rules = gp->state_select;
+
     const char *output_tb_name;
 
+    const char mem_name[] = "serialized_data.mem";
     const char dfl_tb_name[] = "testbench_boilerplate.v";
     const char uart_tb_name[] = "UART_Source_Module.v";
+    const char spi_tb_name[] = "SPI_Source_Module.v";
+    const char can_tb_name[] = "CAN_Source_Module.v";
+
+    gp->tb_path[0] = 0;
+    if(snprintf(gp->mem_path, MAX_PATH_LEN, "%s%s", gp->out_prefix, mem_name) >= MAX_PATH_LEN){
+        printf("FUNCTION MESSAGE: Output path too long!\n");
+        gp->mem_path[0] = 0;
+        return 0;
+    }
+
+    memfile = fopen(gp->mem_path, "w");
+    if(!memfile){
+        printf("FUNCTION MESSAGE: Unable to open %s for writing!\n", gp->mem_path);
+        return 0;
+    }
 
-    memfile = fopen("serialized_data.mem", "w");
+    // Bus load scenarios run to millions of bits, don't flush per line
+    setvbuf(memfile, NULL, _IOFBF, 1 << 16);
 
-    uint16_t serialized_vals = 0;
-    uint32_t baud_delay_ns;
+    uint32_t serialized_vals = 0;
+    struct BAUD_TIMING half_bit;
 
-    baud_delay_ns = (uint32_t)((double)1000000000.0 * (1.0 / (double)baud));
+    // Both testbench styles step in half bit / half SCLK periods
+    baud_timing(&half_bit, gp->baudrate, 2);
 
     switch(rules[PROTOCOL_PTR]){
         case PROTOCOL_UART:
-            serialized_vals = uart_mem_gen(memfile, rules[FORMAT_PTR], data_src, data_len, pause_bits);
+            serialized_vals = uart_mem_gen(memfile, rules[FORMAT_PTR], gp->data_set, gp->data_count, gp->pause);
             output_tb_name = uart_tb_name;
         break;
 
+        case PROTOCOL_SPI:{
+            // File words are stored little endian, inline values byte by byte
+            uint8_t word_bytes = (rules[DATA_SRC_PTR] == DATA_EXTERNAL) ? (gp->datawidth >> 3) : 1;
+            serialized_vals = spi_mem_gen(memfile, rules[FORMAT_PTR], gp->data_set, gp->data_count, word_bytes, gp->pause);
+            output_tb_name = spi_tb_name;
+        }
+        break;
+
+        case PROTOCOL_CAN:
+            serialized_vals = can_mem_gen(memfile, rules[FORMAT_PTR], gp->can_id, gp->data_set, gp->data_count, gp->pause);
+            output_tb_name = can_tb_name;
+        break;
+
         default:
             printf("Unrecognized protocol input!\n");
             output_tb_name = dfl_tb_name;
         break;
     }
 
-    if(serialized_vals && (opt & GENERATE_TB)){
-        tb_file = fopen(output_tb_name, "w");
-        generate_tb(tb_file, rules[PROTOCOL_PTR], baud_delay_ns, serialized_vals);
-        fclose(tb_file);
+    if(serialized_vals && (gp->opt & GENERATE_TB)){
+        if(snprintf(gp->tb_path, MAX_PATH_LEN, "%s%s", gp->out_prefix, output_tb_name) >= MAX_PATH_LEN){
+            printf("FUNCTION MESSAGE: Testbench path too long!\n");
+            gp->tb_path[0] = 0;
+            serialized_vals = 0;
+            tb_file = NULL;
+        } else {
+            tb_file = fopen(gp->tb_path, "w");
+        }
+
+        if(tb_file){
+            if(rules[PROTOCOL_PTR] == PROTOCOL_SPI){
+                generate_spi_tb(tb_file, rules[FORMAT_PTR], &half_bit, serialized_vals, gp->mem_path);
+            } else {
+                generate_tb(tb_file, rules[PROTOCOL_PTR], &half_bit, serialized_vals, gp->mem_path);
+            }
+            fclose(tb_file);
+        } else if(gp->tb_path[0]){
+            printf("FUNCTION MESSAGE: Unable to open %s for writing!\n", gp->tb_path);
+            gp->tb_path[0] = 0;
+        }
     }
 
 #ifdef DEBUG_OUTPUT
@@ -582,13 +869,15 @@ void serializer(uint8_t *rules, uint32_t baud, uint8_t *data_src, uint16_t data_
 #endif // DEBUG_OUTPUT
 
     fclose(memfile);
+
+    return serialized_vals;
 }
 
 // .mem generators return the number of written bytes
 //  eg the number of serial bit events present
 // UART .mem generator
-uint16_t uart_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint16_t data_len, uint32_t pause_bits){
-    uint16_t bytes_written = 0;
+uint32_t uart_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint32_t data_len, uint32_t pause_bits){
+    uint32_t bytes_written = 0;
 
     uint8_t data_bit_ct = fmt_rules & 0x0F;
     uint8_t parity_type = fmt_rules & (0x03 << 4);
@@ -603,7 +892,7 @@ uint16_t uart_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint16_t d
     if(fmt_rules & UART_BIG_ENDIAN){
 
     } else {
-        for(uint16_t n = 0; n < data_len; n++){
+        for(uint32_t n = 0; n < data_len; n++){
             uint8_t parity_chk_accum = 0;       // Acuumulate ones
             fprintf(fp, "0\n");                 // Start bit
             bytes_written += 1;
@@ -658,14 +947,322 @@ uint16_t uart_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint16_t d
 }
 
 
+// SPI lanes per format code, SPI_SINGLE/DUAL/QUAD >> 2
+static const uint8_t spi_lane_ct[4] = {1, 2, 4, 1};
+
+// One packed bus vector {SCLK, CS_n, DATA[lanes-1:0]}
+static void spi_emit(FILE *fp, uint32_t *vals_written, uint8_t lanes, uint8_t sclk, uint8_t cs_n, uint8_t data){
+    uint8_t vec = (sclk << (lanes + 1)) | (cs_n << lanes) | data;
+
+    if(*vals_written) putc(NEWLINE, fp);
+    fprintf(fp, (lanes > 2) ? "%02X" : "%X", vec);
+    *vals_written += 1;
+}
+
+// SPI .mem generator
+//  Every entry is half an SCLK period of the whole bus, so the testbench
+//  drives SCLK, CS_n and all lanes from one memory read. Data goes out
+//  MSB first, lanes bits per clock, one word_bytes wide word at a time.
+//  Words are stored little endian so each one is walked from its top
+//  byte down. Pause bits deassert CS_n for that many SCLK periods
+//  between words, with none the data set is one continuous transfer.
+uint32_t spi_mem_gen(FILE *fp, uint8_t fmt_rules, uint8_t *data_src, uint32_t data_len, uint8_t word_bytes, uint32_t pause_bits){
+    uint32_t vals_written = 0;
+
+    uint8_t cpol = (fmt_rules & SPI_CPOL) ? 1 : 0;
+    uint8_t cpha = (fmt_rules & SPI_CPHA) ? 1 : 0;
+    uint8_t lanes = spi_lane_ct[(fmt_rules & SPI_LANE_MASK) >> 2];
+    uint8_t lane_mask = (1 << lanes) - 1;
+    uint8_t last_chunk = 0;
+#ifdef DEBUG_OUTPUT
+    printf("FUNCTION MESSAGE: SPI Mode %u\n", fmt_rules & SPI_MODE_MASK);
+    printf("FUNCTION MESSAGE: %u Data Lanes\n", lanes);
+#endif // DEBUG_OUTPUT
+
+    // Bus starts idle
+    spi_emit(fp, &vals_written, lanes, cpol, 1, 0);
+
+    if(!word_bytes || data_len % word_bytes){
+        word_bytes = 1;
+    }
+
+    for(uint32_t n = 0; n < data_len; n += word_bytes){
+        // CS_n falling, CPHA 1 needs a half period before the first edge
+        if((n == 0 || pause_bits) && cpha){
+            spi_emit(fp, &vals_written, lanes, cpol, 0, 0);
+        }
+
+        for(int8_t b = word_bytes - 1; b >= 0; b--){
+            for(int8_t shift = 8 - lanes; shift >= 0; shift -= lanes){
+                last_chunk = (data_src[n + b] >> shift) & lane_mask;
+
+                // Data changes on the edge opposite the sampling edge
+                spi_emit(fp, &vals_written, lanes, cpol ^ cpha, 0, last_chunk);
+                spi_emit(fp, &vals_written, lanes, !(cpol ^ cpha), 0, last_chunk);
+            }
+        }
+
+        if(pause_bits || n + word_bytes >= data_len){
+            // CPHA 0 still owes the trailing edge
+            if(!cpha){
+                spi_emit(fp, &vals_written, lanes, cpol, 0, last_chunk);
+            }
+
+            // Write bits between transfers, at least one half period of CS_n high
+            for(uint32_t q = 0; q < MAX(pause_bits << 1, 1); q++){
+                spi_emit(fp, &vals_written, lanes, cpol, 1, 0);
+            }
+        }
+    }
+
+    return vals_written;
+}
+
+// CRC-15/CAN over whole bytes, MSB first, poly 0x4599
+static const uint16_t can_crc15_table[256] = {
+    0x0000, 0x4599, 0x4EAB, 0x0B32, 0x58CF, 0x1D56, 0x1664, 0x53FD,
+    0x7407, 0x319E, 0x3AAC, 0x7F35, 0x2CC8, 0x6951, 0x6263, 0x27FA,
+    0x2D97, 0x680E, 0x633C, 0x26A5, 0x7558, 0x30C1, 0x3BF3, 0x7E6A,
+    0x5990, 0x1C09, 0x173B, 0x52A2, 0x015F, 0x44C6, 0x4FF4, 0x0A6D,
+    0x5B2E, 0x1EB7, 0x1585, 0x501C, 0x03E1, 0x4678, 0x4D4A, 0x08D3,
+    0x2F29, 0x6AB0, 0x6182, 0x241B, 0x77E6, 0x327F, 0x394D, 0x7CD4,
+    0x76B9, 0x3320, 0x3812, 0x7D8B, 0x2E76, 0x6BEF, 0x60DD, 0x2544,
+    0x02BE, 0x4727, 0x4C15, 0x098C, 0x5A71, 0x1FE8, 0x14DA, 0x5143,
+    0x73C5, 0x365C, 0x3D6E, 0x78F7, 0x2B0A, 0x6E93, 0x65A1, 0x2038,
+    0x07C2, 0x425B, 0x4969, 0x0CF0, 0x5F0D, 0x1A94, 0x11A6, 0x543F,
+    0x5E52, 0x1BCB, 0x10F9, 0x5560, 0x069D, 0x4304, 0x4836, 0x0DAF,
+    0x2A55, 0x6FCC, 0x64FE, 0x2167, 0x729A, 0x3703, 0x3C31, 0x79A8,
+    0x28EB, 0x6D72, 0x6640, 0x23D9, 0x7024, 0x35BD, 0x3E8F, 0x7B16,
+    0x5CEC, 0x1975, 0x1247, 0x57DE, 0x0423, 0x41BA, 0x4A88, 0x0F11,
+    0x057C, 0x40E5, 0x4BD7, 0x0E4E, 0x5DB3, 0x182A, 0x1318, 0x5681,
+    0x717B, 0x34E2, 0x3FD0, 0x7A49, 0x29B4, 0x6C2D, 0x671F, 0x2286,
+    0x2213, 0x678A, 0x6CB8, 0x2921, 0x7ADC, 0x3F45, 0x3477, 0x71EE,
+    0x5614, 0x138D, 0x18BF, 0x5D26, 0x0EDB, 0x4B42, 0x4070, 0x05E9,
+    0x0F84, 0x4A1D, 0x412F, 0x04B6, 0x574B, 0x12D2, 0x19E0, 0x5C79,
+    0x7B83, 0x3E1A, 0x3528, 0x70B1, 0x234C, 0x66D5, 0x6DE7, 0x287E,
+    0x793D, 0x3CA4, 0x3796, 0x720F, 0x21F2, 0x646B, 0x6F59, 0x2AC0,
+    0x0D3A, 0x48A3, 0x4391, 0x0608, 0x55F5, 0x106C, 0x1B5E, 0x5EC7,
+    0x54AA, 0x1133, 0x1A01, 0x5F98, 0x0C65, 0x49FC, 0x42CE, 0x0757,
+    0x20AD, 0x6534, 0x6E06, 0x2B9F, 0x7862, 0x3DFB, 0x36C9, 0x7350,
+    0x51D6, 0x144F, 0x1F7D, 0x5AE4, 0x0919, 0x4C80, 0x47B2, 0x022B,
+    0x25D1, 0x6048, 0x6B7A, 0x2EE3, 0x7D1E, 0x3887, 0x33B5, 0x762C,
+    0x7C41, 0x39D8, 0x32EA, 0x7773, 0x248E, 0x6117, 0x6A25, 0x2FBC,
+    0x0846, 0x4DDF, 0x46ED, 0x0374, 0x5089, 0x1510, 0x1E22, 0x5BBB,
+    0x0AF8, 0x4F61, 0x4453, 0x01CA, 0x5237, 0x17AE, 0x1C9C, 0x5905,
+    0x7EFF, 0x3B66, 0x3054, 0x75CD, 0x2630, 0x63A9, 0x689B, 0x2D02,
+    0x276F, 0x62F6, 0x69C4, 0x2C5D, 0x7FA0, 0x3A39, 0x310B, 0x7492,
+    0x5368, 0x16F1, 0x1DC3, 0x585A, 0x0BA7, 0x4E3E, 0x450C, 0x0095
+};
+
+// Bit level frame assembly, MSB first, before stuffing
+struct CAN_FRAME_BITS{
+    uint8_t     buf[16];    // Ext header + 8 data bytes = 103 bits max
+    uint8_t     len;
+};
+
+static void can_push_bits(struct CAN_FRAME_BITS *fb, uint32_t val, uint8_t width){
+    while(width--){
+        uint8_t byte_pt = fb->len >> 3;
+        uint8_t bit_pt = 7 - (fb->len & 0x07);
+
+        if(!bit_pt) fb->buf[byte_pt + 1] = 0;   // Keep the next byte clean
+        if((val >> width) & 0x01) fb->buf[byte_pt] |= (1 << bit_pt);
+
+        fb->len += 1;
+    }
+}
+
+static uint16_t can_crc15(struct CAN_FRAME_BITS *fb){
+    uint16_t crc = 0;
+    uint8_t full_bytes = fb->len >> 3;
+
+    for(uint8_t n = 0; n < full_bytes; n++){
+        crc = ((crc << 8) ^ can_crc15_table[((crc >> 7) ^ fb->buf[n]) & 0xFF]) & 0x7FFF;
+    }
+
+    // Leftover bits of the final partial byte
+    for(uint8_t n = 0; n < (fb->len & 0x07); n++){
+        uint8_t crc_nxt = ((fb->buf[full_bytes] >> (7 - n)) & 0x01) ^ (crc >> 14);
+        crc = (crc << 1) & 0x7FFF;
+        if(crc_nxt) crc ^= CAN_CRC15_POLY;
+    }
+
+    return crc;
+}
+
+// Streaming bit stuffer, a complement bit follows every 5 equal bits
+struct CAN_STUFFER{
+    FILE        *fp;
+    uint32_t    bits_written;
+    uint8_t     last_bit;
+    uint8_t     run_len;
+};
+
+static void can_emit_bit(struct CAN_STUFFER *st, uint8_t bit){
+    if(st->bits_written) putc(NEWLINE, st->fp);
+    putc('0' + bit, st->fp);
+    st->bits_written += 1;
+}
+
+static void can_stuff_bit(struct CAN_STUFFER *st, uint8_t bit){
+    can_emit_bit(st, bit);
+
+    if(st->run_len && bit == st->last_bit){
+        st->run_len += 1;
+    } else {
+        st->last_bit = bit;
+        st->run_len = 1;
+    }
+
+    if(st->run_len == 5){
+        can_emit_bit(st, !bit);
+        st->last_bit = !bit;
+        st->run_len = 1;
+    }
+}
+
+// CAN 2.0 data frame .mem generator
+//  data_src is cut into frames of the format's byte count, all sharing can_id.
+//  The ACK slot is left recessive, as sent by the transmitter, the DUT
+//  is expected to drive it dominant. The stream opens with 11 recessive
+//  bits so a receiver coming out of reset can integrate onto the bus.
+uint32_t can_mem_gen(FILE *fp, uint8_t fmt_rules, uint32_t can_id, uint8_t *data_src, uint32_t data_len, uint32_t pause_bits){
+    struct CAN_STUFFER st = {fp, 0, 0, 0};
+
+    uint8_t extended = fmt_rules & CAN_EXT_ID;
+    uint8_t frame_bytes = fmt_rules & CAN_DLC_MASK;
+
+#ifdef DEBUG_OUTPUT
+    printf("FUNCTION MESSAGE: CAN %s ID 0x%X\n", extended ? "Extended" : "Standard", can_id);
+    printf("FUNCTION MESSAGE: %u Bytes per Frame\n", frame_bytes);
+#endif // DEBUG_OUTPUT
+
+    // Bus idle so the receiver integrates before the first SOF
+    for(uint8_t m = 0; data_len && m < CAN_IDLE_BITS; m++){
+        can_emit_bit(&st, 1);
+    }
+
+    for(uint32_t n = 0; n < data_len; n += frame_bytes){
+        struct CAN_FRAME_BITS fb;
+        uint8_t dlc = ((data_len - n) < frame_bytes) ? (data_len - n) : frame_bytes;
+
+        fb.len = 0;
+        fb.buf[0] = 0;
+
+        can_push_bits(&fb, 0, 1);                       // SOF
+        if(extended){
+            can_push_bits(&fb, can_id >> 18, 11);       // Base ID
+            can_push_bits(&fb, 0x03, 2);                // SRR, IDE
+            can_push_bits(&fb, can_id, 18);             // ID extension
+            can_push_bits(&fb, 0x00, 3);                // RTR, r1, r0
+        } else {
+            can_push_bits(&fb, can_id, 11);
+            can_push_bits(&fb, 0x00, 3);                // RTR, IDE, r0
+        }
+        can_push_bits(&fb, dlc, 4);
+
+        for(uint8_t m = 0; m < dlc; m++){
+            can_push_bits(&fb, data_src[n + m], 8);
+        }
+
+        uint16_t crc = can_crc15(&fb);
+
+        // Stuffing covers SOF through the CRC sequence
+        st.run_len = 0;
+        for(uint8_t m = 0; m < fb.len; m++){
+            can_stuff_bit(&st, (fb.buf[m >> 3] >> (7 - (m & 0x07))) & 0x01);
+        }
+
+        for(int8_t m = 14; m >= 0; m--){
+            can_stuff_bit(&st, (crc >> m) & 0x01);
+        }
+
+        // CRC delimiter, ACK slot, ACK delimiter, EOF, intermission
+        for(uint8_t m = 0; m < 3 + 7 + 3; m++){
+            can_emit_bit(&st, 1);
+        }
+
+        // Write bits between data frames
+        for(uint32_t q = 0; q < pause_bits; q++){
+            can_emit_bit(&st, 1);
+        }
+    }
+
+    return st.bits_written;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Picosecond timing engine
+//  A truncated ns delay drifts a little every bit, which adds up fast
+//  on high speed links. Instead the step length is kept as an exact
+//  fraction of a picosecond and the testbench carries an accumulator
+//  that stretches single steps by 1ps, so the long run rate is exact.
+void baud_timing(struct BAUD_TIMING *bt, uint32_t baud, uint8_t steps_per_bit){
+    uint64_t den = (uint64_t)baud * steps_per_bit;
+    uint64_t num = PS_PER_S % den;
+
+    bt->step_ps = PS_PER_S / den;
+    bt->startup_ps = PS_PER_S / baud;
+
+    // Keep the fraction small, GCD reduce
+    uint64_t a = num;
+    uint64_t b = den;
+    while(b){
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    bt->frac_num = num ? num / a : 0;
+    bt->frac_den = num ? den / a : 1;
+
+#ifdef DEBUG_OUTPUT
+    printf("FUNCTION MESSAGE: Step %llu + %llu/%llu ps\n", (unsigned long long)bt->step_ps,
+            (unsigned long long)bt->frac_num, (unsigned long long)bt->frac_den);
+#endif // DEBUG_OUTPUT
+}
+
+// Step length parameters and accumulator declaration
+static void tb_timing_decl(FILE *fp, struct BAUD_TIMING *bt, const char *step_name){
+    fprintf(fp, "\n\t// %s = STEP_PS", step_name);
+    if(bt->frac_num) fprintf(fp, " + STEP_FRAC_NUM / STEP_FRAC_DEN");
+    fprintf(fp, " ps");
+    fprintf(fp, "\n\tlocalparam [63:0] STEP_PS = 64'd%llu;", (unsigned long long)bt->step_ps);
+    // A whole period passes 32 bits of ps below ~233 baud, keep it sized
+    fprintf(fp, "\n\tlocalparam [63:0] STARTUP_PS = 64'd%llu;", (unsigned long long)bt->startup_ps);
+
+    if(bt->frac_num){
+        fprintf(fp, "\n\tlocalparam [63:0] STEP_FRAC_NUM = 64'd%llu;", (unsigned long long)bt->frac_num);
+        fprintf(fp, "\n\tlocalparam [63:0] STEP_FRAC_DEN = 64'd%llu;", (unsigned long long)bt->frac_den);
+        fprintf(fp, "\n\treg [63:0] frac_acc;");
+    }
+    fprintf(fp, "\n");
+}
+
+// One step delay, stretched by 1ps whenever the fraction rolls over
+static void tb_timing_step(FILE *fp, struct BAUD_TIMING *bt, const char *indent){
+    if(bt->frac_num){
+        fprintf(fp, "frac_acc = frac_acc + STEP_FRAC_NUM;\n%s", indent);
+        fprintf(fp, "if(frac_acc >= STEP_FRAC_DEN) begin\n%s\t", indent);
+        fprintf(fp, "frac_acc = frac_acc - STEP_FRAC_DEN;\n%s\t", indent);
+        fprintf(fp, "#(STEP_PS + 1);\n%s", indent);
+        fprintf(fp, "end else #(STEP_PS);\n");
+    } else {
+        fprintf(fp, "#(STEP_PS);\n");
+    }
+}
+
 // Boilerplate testbench generation
-void generate_tb(FILE *fp, uint8_t protocol, uint32_t delay_ns, uint16_t values_written){
+void generate_tb(FILE *fp, uint8_t protocol, struct BAUD_TIMING *bt, uint32_t values_written, const char *mem_path){
     char START_VAL = '0';
 
     fprintf(fp, "// This module has been autogenerated\n");
     fprintf(fp, "// so you likely will need to change how\n");
     fprintf(fp, "// this works. Good luck! :)\n");
 
+    fprintf(fp, "\n`timescale 1ps/1ps\n");
+
     fprintf(fp, "\nmodule ");
 
     switch(protocol){
@@ -674,6 +1271,12 @@ void generate_tb(FILE *fp, uint8_t protocol, uint32_t delay_ns, uint16_t values_
 
             START_VAL = '1';
         break;
+
+        case PROTOCOL_CAN:
+            fprintf(fp, "CAN_source");
+
+            START_VAL = '1';    // Recessive idle bus
+        break;
     }
 
     fprintf(fp, "\n(\n");
@@ -684,20 +1287,23 @@ void generate_tb(FILE *fp, uint8_t protocol, uint32_t delay_ns, uint16_t values_
     fprintf(fp, "\toutput reg SERIAL_STREAM\n\t,output reg BAUD_CLK\n);");
     fprintf(fp, "\n\t// Bitstream length");
     fprintf(fp, "\n\tlocalparam SERIALIZED_LEN = %u;\n", values_written);
+    tb_timing_decl(fp, bt, "Half BAUD period");
     fprintf(fp, "\n\tinteger n;\n\treg serialized_values[0:%u];\n", values_written - 1);
     fprintf(fp, "\n\tinitial begin\n\t\tn = 0;\n\t\tBAUD_CLK = 0;\n\t\tSERIAL_STREAM = %c;\n", START_VAL);
-    fprintf(fp, "\t\t$readmemh(\"serialized_data.mem\", serialized_values);\n\n");
+    if(bt->frac_num) fprintf(fp, "\t\tfrac_acc = 0;\n");
+    fprintf(fp, "\t\t$readmemh(\"%s\", serialized_values);\n\n", mem_path);
 
-    fprintf(fp, "\t\t#%u;\t//Startup Delay of 1 BAUD period\n", delay_ns);
+    fprintf(fp, "\t\t#(STARTUP_PS);\t//Startup Delay of 1 BAUD period\n");
 
     fprintf(fp, "\n\t\tforever begin\n\t\t\t");
     fprintf(fp, "SERIAL_STREAM <= serialized_values[n];\n\t\t\t");
     fprintf(fp, "if(n < SERIALIZED_LEN - 1) n <= n + 1;\n\t\t\t");
     fprintf(fp, "else n <= 0;\n\t\t\t");
     fprintf(fp, "BAUD_CLK <= 1;\n\t\t\t");
-    fprintf(fp, "#%u;\t// ns, This determines your baudrate\n\t\t\t", delay_ns >> 1);
-    fprintf(fp, "BAUD_CLK <= 0;\n\t\t\t");
-    fprintf(fp, "#%u;\t// ns, This determines your baudrate\n\t\tend\n", delay_ns >> 1);
+    tb_timing_step(fp, bt, "\t\t\t");
+    fprintf(fp, "\t\t\tBAUD_CLK <= 0;\n\t\t\t");
+    tb_timing_step(fp, bt, "\t\t\t");
+    fprintf(fp, "\t\tend\n");
 
 
 
@@ -705,6 +1311,418 @@ void generate_tb(FILE *fp, uint8_t protocol, uint32_t delay_ns, uint16_t values_
 
 }
 
+// SPI testbench, whole bus is one packed memory word per half SCLK period
+void generate_spi_tb(FILE *fp, uint8_t fmt_rules, struct BAUD_TIMING *bt, uint32_t values_written, const char *mem_path){
+    uint8_t lanes = spi_lane_ct[(fmt_rules & SPI_LANE_MASK) >> 2];
+    uint8_t cpol = (fmt_rules & SPI_CPOL) ? 1 : 0;
+
+    fprintf(fp, "// This module has been autogenerated\n");
+    fprintf(fp, "// so you likely will need to change how\n");
+    fprintf(fp, "// this works. Good luck! :)\n");
+
+    fprintf(fp, "\n`timescale 1ps/1ps\n");
+
+    fprintf(fp, "\n// SPI Mode %u, %u data lane(s)", fmt_rules & SPI_MODE_MASK, lanes);
+    fprintf(fp, "\n// Bus vector: {SCLK, CS_N, SPI_DATA[%u:0]}", lanes - 1);
+    fprintf(fp, "\nmodule SPI_source\n(\n");
+
+    fprintf(fp, "\toutput reg SCLK\n\t,output reg CS_N\n\t,output reg [%u:0] SPI_DATA\n);", lanes - 1);
+    fprintf(fp, "\n\t// Bus vector length, one entry per half SCLK period");
+    fprintf(fp, "\n\tlocalparam SERIALIZED_LEN = %u;\n", values_written);
+    tb_timing_decl(fp, bt, "Half SCLK period");
+    fprintf(fp, "\n\tinteger n;\n\treg [%u:0] serialized_values[0:%u];\n", lanes + 1, values_written - 1);
+    fprintf(fp, "\n\tinitial begin\n\t\tn = 0;\n\t\tSCLK = %u;\n\t\tCS_N = 1;\n\t\tSPI_DATA = 0;\n", cpol);
+    if(bt->frac_num) fprintf(fp, "\t\tfrac_acc = 0;\n");
+    fprintf(fp, "\t\t$readmemh(\"%s\", serialized_values);\n\n", mem_path);
+
+    fprintf(fp, "\t\t#(STARTUP_PS);\t//Startup Delay of 1 SCLK period\n");
+
+    fprintf(fp, "\n\t\tforever begin\n\t\t\t");
+    fprintf(fp, "{SCLK, CS_N, SPI_DATA} <= serialized_values[n];\n\t\t\t");
+    fprintf(fp, "if(n < SERIALIZED_LEN - 1) n <= n + 1;\n\t\t\t");
+    fprintf(fp, "else n <= 0;\n\t\t\t");
+    tb_timing_step(fp, bt, "\t\t\t");
+    fprintf(fp, "\t\tend\n");
+
+    fprintf(fp, "\t\n\tend\nendmodule");
+
+}
+
+#ifdef SERVER_SUPPORT
+/////////////////////////////////////////////////////////////////////////////
+// Persistent generator daemon
+//
+//  ./serialSourceGen -S /tmp/ssg.sock [workers]
+//
+//  Each connection sends one request line holding the same arguments
+//  the command line takes, eg.
+//      -p uart -f 8N1 -d 0xAA 0x55 - -b 500000 -T -o run0_
+//  and receives one reply line:
+//      OK <mem path> [<testbench path>]
+//      ERR <reason>
+//  If no -o prefix is given a unique "req<N>_" prefix is used so
+//  concurrent requests never write over each other.
+
+// Parsed -D files are kept here so repeat requests skip the parse
+struct EXTFILE_CACHE_ENTRY{
+    char        path[MAX_PATH_LEN];
+    uint8_t     basesel;
+    uint8_t     d_width;
+    dev_t       dev;
+    ino_t       ino;
+    off_t       size;
+    struct timespec mtim;
+    struct timespec ctim;
+    uint32_t    last_use;
+    uint8_t     *data_buffer;
+    uint32_t    data_length;
+};
+
+static struct EXTFILE_CACHE_ENTRY extfile_cache[EXTFILE_CACHE_LEN];
+static uint32_t extfile_cache_tick = 0;
+static pthread_mutex_t extfile_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Bounded hand off between the accept loop and the worker pool
+struct SERVER_QUEUE{
+    int             fds[SERVER_QUEUE_LEN];
+    uint32_t        ids[SERVER_QUEUE_LEN];
+    uint16_t        head;
+    uint16_t        tail;
+    uint16_t        count;
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+};
+
+static struct SERVER_QUEUE srv_queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Nonzero if the entry was parsed from the file st describes, unchanged
+static uint8_t extfile_cache_same_file(struct EXTFILE_CACHE_ENTRY *ce, struct stat *st){
+    return ce->dev == st->st_dev
+        && ce->ino == st->st_ino
+        && ce->size == st->st_size
+        && ce->mtim.tv_sec == st->st_mtim.tv_sec
+        && ce->mtim.tv_nsec == st->st_mtim.tv_nsec
+        && ce->ctim.tv_sec == st->st_ctim.tv_sec
+        && ce->ctim.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Nonzero if the file changed too recently to trust its timestamps.
+//  File systems stamp with a coarse clock, two writes a few ms apart
+//  can leave identical times behind, so such files are parsed every time
+//  until they settle.
+static uint8_t extfile_recently_changed(struct stat *st){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    int64_t age_ms = (int64_t)(now.tv_sec - st->st_ctim.tv_sec) * 1000
+                   + (now.tv_nsec - st->st_ctim.tv_nsec) / 1000000;
+
+    return age_ms < EXTFILE_SETTLE_MS;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Matching cache entry, or NULL. Caller holds extfile_cache_lock.
+//  victim is set to the slot a new entry should replace.
+static struct EXTFILE_CACHE_ENTRY *extfile_cache_find(char *filepath, const uint8_t basesel, uint8_t d_width,
+                                                       struct stat *st, struct EXTFILE_CACHE_ENTRY **victim){
+    *victim = &extfile_cache[0];
+
+    for(uint16_t n = 0; n < EXTFILE_CACHE_LEN; n++){
+        struct EXTFILE_CACHE_ENTRY *ce = &extfile_cache[n];
+
+        if(ce->data_buffer
+            && ce->basesel == basesel
+            && ce->d_width == d_width
+            && extfile_cache_same_file(ce, st)
+            && !strcmp(ce->path, filepath)){
+            return ce;
+        }
+
+        // Prefer empty slots, then the least recently used
+        if((*victim)->data_buffer && (!ce->data_buffer || ce->last_use < (*victim)->last_use)){
+            *victim = ce;
+        }
+    }
+
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// handle_external_data() with a small LRU cache in front of it,
+//  entries are dropped when the file changes on disk. The caller always
+//  gets its own copy of the buffer so it can be freed as usual.
+//  Parsing happens outside the lock so a large file only holds up the
+//  request that asked for it.
+uint8_t cached_external_data(struct EXTFILE_IO *file_params, char *filepath, const uint8_t basesel, uint8_t d_width){
+    struct stat st;
+    struct EXTFILE_CACHE_ENTRY *hit;
+    struct EXTFILE_CACHE_ENTRY *victim;
+    uint8_t retval = 0;
+
+    if(stat(filepath, &st) || strlen(filepath) >= MAX_PATH_LEN){
+        return handle_external_data(file_params, filepath, basesel, d_width);
+    }
+
+    pthread_mutex_lock(&extfile_cache_lock);
+
+    hit = extfile_cache_find(filepath, basesel, d_width, &st, &victim);
+    if(hit){
+#ifdef DEBUG_OUTPUT
+        printf("FUNCTION MESSAGE: Cached data for %s\n", filepath);
+#endif // DEBUG_OUTPUT
+        hit->last_use = ++extfile_cache_tick;
+
+        file_params->data_length = hit->data_length;
+        file_params->data_buffer = (uint8_t *)malloc(MAX(hit->data_length, 1));
+
+        if(file_params->data_buffer){
+            memcpy(file_params->data_buffer, hit->data_buffer, hit->data_length);
+        } else {
+            retval = RETURN_ERROR;
+        }
+    }
+
+    pthread_mutex_unlock(&extfile_cache_lock);
+
+    if(hit){
+        return retval;
+    }
+
+    // Miss, the caller keeps the parsed buffer and the cache gets a copy
+    retval = handle_external_data(file_params, filepath, basesel, d_width);
+    if(retval || extfile_recently_changed(&st)){
+        return retval;
+    }
+
+    uint8_t *cache_copy = (uint8_t *)malloc(MAX(file_params->data_length, 1));
+    if(!cache_copy){
+        return retval;
+    }
+    memcpy(cache_copy, file_params->data_buffer, file_params->data_length);
+
+    pthread_mutex_lock(&extfile_cache_lock);
+
+    // Another worker may have parsed the same file meanwhile, keep theirs
+    hit = extfile_cache_find(filepath, basesel, d_width, &st, &victim);
+    if(hit){
+        free(cache_copy);
+    } else {
+        free(victim->data_buffer);
+        strcpy(victim->path, filepath);
+        victim->basesel = basesel;
+        victim->d_width = d_width;
+        victim->dev = st.st_dev;
+        victim->ino = st.st_ino;
+        victim->size = st.st_size;
+        victim->mtim = st.st_mtim;
+        victim->ctim = st.st_ctim;
+        victim->data_buffer = cache_copy;
+        victim->data_length = file_params->data_length;
+        hit = victim;
+    }
+    hit->last_use = ++extfile_cache_tick;
+
+    pthread_mutex_unlock(&extfile_cache_lock);
+
+    return retval;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Read, run and answer a single request
+void server_handle_request(int fd, uint32_t req_id){
+    char req[SERVER_MAX_REQ_LEN];
+    char *req_argv[SERVER_MAX_TOKENS + 2];
+    int req_argc = 0;
+    size_t req_len = 0;
+    char dfl_name[] = "serialSourceGen";
+
+    // One line per request, which must arrive within the deadline so
+    //  idle clients can't hold on to a worker
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 + SERVER_TIMEOUT_MS;
+
+    while(req_len < SERVER_MAX_REQ_LEN - 1){
+        struct pollfd pfd = {fd, POLLIN, 0};
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t remaining_ms = deadline_ms - ((int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+
+        if(remaining_ms <= 0 || poll(&pfd, 1, (int)remaining_ms) == 0){
+            dprintf(fd, "ERR Timeout\n");
+            return;
+        }
+
+        ssize_t rd = read(fd, &req[req_len], SERVER_MAX_REQ_LEN - 1 - req_len);
+        if(rd <= 0) break;
+        req_len += rd;
+        if(memchr(&req[req_len - rd], NEWLINE, rd)) break;
+    }
+    req[req_len] = 0;
+
+    req_argv[req_argc++] = dfl_name;
+
+    char *save_ptr;
+    for(char *tok = strtok_r(req, " \t\r\n", &save_ptr); tok; tok = strtok_r(NULL, " \t\r\n", &save_ptr)){
+        if(req_argc > SERVER_MAX_TOKENS){
+            dprintf(fd, "ERR Too many arguments\n");
+            return;
+        }
+        req_argv[req_argc++] = tok;
+    }
+
+    if(req_argc < MINARGS){
+        dprintf(fd, "ERR Invalid number of arguments\n");
+        return;
+    }
+
+    req_argv[req_argc] = NULL;
+
+    struct GEN_PARAMS gp;
+    init_gen_params(&gp);
+
+    parse_args(&gp, req_argc, req_argv);
+
+    if(!gp.out_prefix[0]){
+        snprintf(gp.out_prefix, MAX_PATH_LEN, "req%u_", req_id);
+    }
+
+    const char *entry_error = gen_params_error(&gp);
+    if(entry_error){
+        dprintf(fd, "ERR %s\n", entry_error);
+    } else if(!serializer(&gp)){
+        dprintf(fd, "ERR Serialization\n");
+    } else if(gp.tb_path[0]){
+        dprintf(fd, "OK %s %s\n", gp.mem_path, gp.tb_path);
+    } else {
+        dprintf(fd, "OK %s\n", gp.mem_path);
+    }
+
+    free(gp.data_set);
+}
+
+void *server_worker(void *arg){
+    (void)arg;
+
+    for(;;){
+        pthread_mutex_lock(&srv_queue.lock);
+        while(!srv_queue.count) pthread_cond_wait(&srv_queue.not_empty, &srv_queue.lock);
+
+        int fd = srv_queue.fds[srv_queue.tail];
+        uint32_t req_id = srv_queue.ids[srv_queue.tail];
+        srv_queue.tail = (srv_queue.tail + 1) % SERVER_QUEUE_LEN;
+        srv_queue.count -= 1;
+
+        pthread_cond_signal(&srv_queue.not_full);
+        pthread_mutex_unlock(&srv_queue.lock);
+
+        server_handle_request(fd, req_id);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Listen on a UNIX domain socket, never returns unless setup fails
+void run_server(const char *sock_path, uint32_t workers){
+    struct sockaddr_un addr;
+    pthread_t pool[SERVER_MAX_WORKERS];
+    uint32_t req_id = 0;
+    int srv_fd;
+
+    if(!workers || workers > SERVER_MAX_WORKERS){
+        printf("Invalid worker count. Defaulting to %u workers.\n", SERVER_WORKERS);
+        workers = SERVER_WORKERS;
+    }
+
+    if(strlen(sock_path) >= sizeof(addr.sun_path)){
+        printf("Socket path too long!\n");
+        return;
+    }
+
+    // Only a stale socket from an earlier run may be replaced
+    struct stat sock_st;
+    if(!lstat(sock_path, &sock_st)){
+        if(!S_ISSOCK(sock_st.st_mode)){
+            printf("%s exists and is not a socket!\n", sock_path);
+            return;
+        }
+        unlink(sock_path);
+    }
+
+    // Clients hanging up early must not take the daemon down
+    signal(SIGPIPE, SIG_IGN);
+
+    // Keep the log readable when stdout is redirected
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    srv_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(srv_fd < 0){
+        printf("Unable to create socket!\n");
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+
+    // Requests can read and write any file the daemon can, so the
+    //  socket is created owner only (0600)
+    mode_t old_mask = umask(0177);
+    int bind_err = bind(srv_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if(bind_err || chmod(sock_path, S_IRUSR | S_IWUSR) || listen(srv_fd, SERVER_QUEUE_LEN)){
+        printf("Unable to listen on %s!\n", sock_path);
+        close(srv_fd);
+        return;
+    }
+
+    extfile_cache_enabled = 1;
+
+    for(uint32_t n = 0; n < workers; n++){
+        if(pthread_create(&pool[n], NULL, server_worker, NULL)){
+            printf("Unable to start worker %u!\n", n);
+            close(srv_fd);
+            return;
+        }
+    }
+
+    printf("Serving on %s with %u workers\n", sock_path, workers);
+
+    for(;;){
+        int fd = accept(srv_fd, NULL, NULL);
+        if(fd < 0){
+            // Out of descriptors, give in flight requests time to release theirs
+            if(errno == EMFILE || errno == ENFILE){
+                printf("accept: %s, backing off\n", strerror(errno));
+                usleep(SERVER_BACKOFF_US);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&srv_queue.lock);
+        while(srv_queue.count == SERVER_QUEUE_LEN) pthread_cond_wait(&srv_queue.not_full, &srv_queue.lock);
+
+        srv_queue.fds[srv_queue.head] = fd;
+        srv_queue.ids[srv_queue.head] = req_id++;
+        srv_queue.head = (srv_queue.head + 1) % SERVER_QUEUE_LEN;
+        srv_queue.count += 1;
+
+        pthread_cond_signal(&srv_queue.not_empty);
+        pthread_mutex_unlock(&srv_queue.lock);
+    }
+}
+#endif // SERVER_SUPPORT
+
 
 
 
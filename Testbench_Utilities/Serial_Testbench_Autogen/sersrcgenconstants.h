@@ -23,6 +23,24 @@
 #define UART_1_STOP     (0 << 6)
 #define UART_2_STOP     (1 << 6)
 
+#define SPI_CPHA        (1 << 0)        // Mode bit 0, sample on trailing edge
+#define SPI_CPOL        (1 << 1)        // Mode bit 1, SCLK idles high
+#define SPI_MODE_MASK   0x03
+#define SPI_SINGLE      (0 << 2)
+#define SPI_DUAL        (1 << 2)
+#define SPI_QUAD        (2 << 2)
+#define SPI_LANE_MASK   (0x03 << 2)
+
+#define CAN_STD_ID      (0 << 7)        // 11 bit identifier, CAN 2.0A
+#define CAN_EXT_ID      (1 << 7)        // 29 bit identifier, CAN 2.0B
+#define CAN_DLC_MASK    0x0F            // Data bytes per frame
+#define CAN_MAX_DLC     8
+#define CAN_STD_ID_MASK 0x000007FF
+#define CAN_EXT_ID_MASK 0x1FFFFFFF
+#define CAN_ID_INVALID  0xFFFFFFFF      // -I value that was not a 29 bit hex number
+#define CAN_CRC15_POLY  0x4599
+#define CAN_IDLE_BITS   11              // Recessive bits a node needs to integrate
+
 
 #define DATA_SRC_PTR    2
 #define MAX_DIN_CT      16
@@ -31,8 +49,27 @@
 #define DATA_EXTERNAL   (1 << 7)
 
 
+#define OUTPUT_PTR      3
+
 #define GENERATE_TB     (1 << 0)
 
+#define PS_PER_S        1000000000000ULL   // Testbench timescale is 1ps
+
+
+#define MAX_PATH_LEN        256
+#define MAX_OUT_PREFIX_LEN  (MAX_PATH_LEN - sizeof("testbench_boilerplate.v"))  // Room for the longest file name
+
+// Daemon (-S) settings
+#define SERVER_WORKERS      4       // Default worker pool size
+#define SERVER_MAX_WORKERS  64
+#define SERVER_QUEUE_LEN    32      // Pending connections before accept blocks
+#define SERVER_MAX_REQ_LEN  4096    // Bytes per request line
+#define SERVER_MAX_TOKENS   256     // Arguments per request line
+#define SERVER_BACKOFF_US   100000  // accept() retry delay when out of descriptors
+#define SERVER_TIMEOUT_MS   5000    // Time a client gets to send its request line
+#define EXTFILE_CACHE_LEN   8       // Parsed -D files kept warm between requests
+#define EXTFILE_SETTLE_MS   1000    // Files changed more recently than this are not cached
+
 
 
 
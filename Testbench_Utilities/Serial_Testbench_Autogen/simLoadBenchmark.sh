@@ -0,0 +1,207 @@
+#!/usr/bin/env bash
+#
+#   Simulation Load Benchmark
+#
+#   Pushes the same data sets through a sample of the output formats the
+#   Serial Source Generator produces, then loads and runs each generated
+#   testbench under whatever open source simulators are installed
+#   (Icarus Verilog and/or Verilator 5+).
+#
+#   Recorded per run, as CSV:
+#       tool time, .mem size, simulator build time, simulator load time,
+#       simulator peak RSS, full run time, entries and payload bits per
+#       wall second
+#
+#   Usage:
+#       ./simLoadBenchmark.sh [data set sizes in bytes...]
+#
+#   Environment:
+#       SSG     generator binary (built from source if not given)
+#       SIMS    simulators to try, default "iverilog verilator"
+#       OUT     CSV output file, default sim_benchmark.csv
+#       BAUD    baudrate / SCLK for every run, default 1000000
+#
+#   Load time is the wall time to start the simulator, read the .mem and
+#   take the first step. Peak RSS needs GNU time, it reads "-" otherwise.
+#   A step that exits non zero reads "-" for both its time and RSS.
+
+set -u
+
+SRC_DIR=$(cd "$(dirname "$0")" && pwd)
+SIMS=${SIMS:-"iverilog verilator"}
+OUT=${OUT:-sim_benchmark.csv}
+BAUD=${BAUD:-1000000}
+
+if [ $# -gt 0 ]; then
+    SIZES="$*"
+else
+    SIZES="256 4096 65536"
+fi
+
+# Every protocol, UART parity, SPI mode, SPI lane count and CAN ID type.
+#  Not every combination of them, nor every UART width or CAN byte count.
+CONFIGS="
+uart_8N1|-p uart -f 8N1
+uart_7O1|-p uart -f 7O1
+uart_8E2|-p uart -f 8E2
+spi_m0_single|-p spi -f 0
+spi_m1_single|-p spi -f 1
+spi_m2_quad|-p spi -f 2Q
+spi_m3_dual|-p spi -f 3D
+spi_m0_quad|-p spi -f 0Q
+can_std_8|-p can -f S8 -I 123
+can_ext_8|-p can -f E8 -I 1ABCDEF
+"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+GNU_TIME=""
+for t in /usr/bin/time gtime; do
+    if command -v "$t" > /dev/null 2>&1 && "$t" -f "%e" true > /dev/null 2>&1; then
+        GNU_TIME=$(command -v "$t")
+        break
+    fi
+done
+
+if [ -z "$GNU_TIME" ]; then
+    echo "GNU time not found, peak RSS will not be recorded."
+fi
+
+# Print "<wall seconds> <peak rss kB>" for the command in "$@",
+#  or "- -" if it exited non zero. The exit status is also returned.
+#  Wall time always comes from date, GNU time's %e is only 10ms
+#  resolution which rounds small runs down to zero.
+run_timed() {
+    local start end status rss="-"
+    start=$(date +%s.%N)
+    if [ -n "$GNU_TIME" ]; then
+        "$GNU_TIME" -f "%M" -o "$WORK/time.txt" "$@" > "$WORK/cmd.log" 2>&1
+    else
+        "$@" > "$WORK/cmd.log" 2>&1
+    fi
+    status=$?
+    end=$(date +%s.%N)
+
+    if [ $status -ne 0 ]; then
+        echo "- -"
+        return $status
+    fi
+
+    [ -n "$GNU_TIME" ] && rss=$(tail -n 1 "$WORK/time.txt")
+    awk -v s="$start" -v e="$end" -v r="$rss" 'BEGIN { printf "%.6f %s\n", e - s, r }'
+}
+
+if [ -z "${SSG:-}" ]; then
+    SSG="$WORK/serialSourceGen"
+    echo "Building generator..."
+    if ! gcc -O2 "$SRC_DIR/serialSourceGenerator.c" -o "$SSG" -lpthread; then
+        echo "Generator build failed!"
+        exit 1
+    fi
+fi
+
+AVAILABLE=""
+for sim in $SIMS; do
+    case $sim in
+        iverilog)
+            command -v iverilog > /dev/null 2>&1 && command -v vvp > /dev/null 2>&1 && AVAILABLE="$AVAILABLE iverilog"
+        ;;
+        verilator)
+            command -v verilator > /dev/null 2>&1 && AVAILABLE="$AVAILABLE verilator"
+        ;;
+        *)
+            echo "Unknown simulator $sim, skipping."
+        ;;
+    esac
+done
+
+if [ -z "$AVAILABLE" ]; then
+    echo "No simulator found, only generator numbers will be recorded."
+    AVAILABLE="none"
+fi
+
+# Top level that times one full pass over the generated memory.
+#  +loadonly stops right after the first step out of the startup delay.
+write_top() {
+    cat > "$WORK/bench_top.v" <<EOF
+\`timescale 1ps/1ps
+module bench_top;
+    $1 dut();
+
+    initial begin
+        if(\$test\$plusargs("loadonly")) begin
+            wait(dut.n == 1);
+        end else begin
+            wait(dut.n == dut.SERIALIZED_LEN - 1);
+            wait(dut.n == 0);
+        end
+        \$finish;
+    end
+endmodule
+EOF
+}
+
+echo "sim,config,data_bytes,tool_s,mem_bytes,entries,build_s,load_s,load_rss_kb,run_s,run_rss_kb,entries_per_s,payload_bits_per_s" > "$OUT"
+
+for size in $SIZES; do
+    # Same pseudo random data set for every format
+    awk -v n="$size" 'BEGIN { srand(1); for(i = 0; i < n; i++) printf "%02X\n", int(rand() * 256) }' > "$WORK/data_$size.txt"
+
+    echo "$CONFIGS" | while IFS='|' read -r name args; do
+        [ -z "$name" ] && continue
+
+        rm -f "$WORK"/run_*
+        # shellcheck disable=SC2086
+        read -r tool_s _ <<< "$(cd "$WORK" && run_timed "$SSG" $args -D "data_$size.txt" -b "$BAUD" -T -o run_)"
+
+        tb=$(ls "$WORK"/run_*_Source_Module.v 2> /dev/null | head -n 1)
+        if [ "$tool_s" = "-" ] || [ ! -s "$WORK/run_serialized_data.mem" ] || [ -z "$tb" ]; then
+            echo "$name ($size bytes): generation failed, see output below"
+            cat "$WORK/cmd.log"
+            continue
+        fi
+
+        mem_bytes=$(wc -c < "$WORK/run_serialized_data.mem" | tr -d ' ')
+        entries=$(sed -n 's/.*localparam SERIALIZED_LEN = \([0-9]*\);.*/\1/p' "$tb")
+        module=$(sed -n 's/^module \([A-Za-z_]*\).*/\1/p' "$tb")
+        write_top "$module"
+
+        for sim in $AVAILABLE; do
+            build_s="-"; load_s="-"; load_rss="-"; run_s="-"; run_rss="-"
+
+            case $sim in
+                iverilog)
+                    read -r build_s _ <<< "$(cd "$WORK" && run_timed iverilog -o sim.vvp -s bench_top bench_top.v "$tb")"
+                    if [ "$build_s" != "-" ] && [ -f "$WORK/sim.vvp" ]; then
+                        read -r load_s load_rss <<< "$(cd "$WORK" && run_timed vvp -n sim.vvp +loadonly)"
+                        [ "$load_s" != "-" ] && read -r run_s run_rss <<< "$(cd "$WORK" && run_timed vvp -n sim.vvp)"
+                    fi
+                    rm -f "$WORK/sim.vvp"
+                ;;
+
+                verilator)
+                    read -r build_s _ <<< "$(cd "$WORK" && run_timed verilator --binary --timing -Wno-fatal -Wno-lint -Wno-style \
+                                                --top-module bench_top -Mdir obj_dir bench_top.v "$tb")"
+                    if [ "$build_s" != "-" ] && [ -x "$WORK/obj_dir/Vbench_top" ]; then
+                        read -r load_s load_rss <<< "$(cd "$WORK" && run_timed obj_dir/Vbench_top +loadonly)"
+                        [ "$load_s" != "-" ] && read -r run_s run_rss <<< "$(cd "$WORK" && run_timed obj_dir/Vbench_top)"
+                    fi
+                    rm -rf "$WORK/obj_dir"
+                ;;
+            esac
+
+            if [ "$sim" != "none" ] && { [ "$build_s" = "-" ] || [ "$load_s" = "-" ] || [ "$run_s" = "-" ]; }; then
+                echo "$name ($size bytes): $sim failed, see output below"
+                cat "$WORK/cmd.log"
+            fi
+
+            rates=$(awk -v t="$run_s" -v e="$entries" -v b="$size" \
+                'BEGIN { if(t == "-" || t + 0 <= 0) print "-,-"; else printf "%.0f,%.0f\n", e / t, b * 8 / t }')
+
+            echo "$sim,$name,$size,$tool_s,$mem_bytes,$entries,$build_s,$load_s,$load_rss,$run_s,$run_rss,$rates" | tee -a "$OUT"
+        done
+    done
+done
+
+echo "Results written to $OUT"